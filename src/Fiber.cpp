@@ -98,6 +98,7 @@ namespace wxm {
     /// @details 总之，流程可以统一为先维护 runningFiber，然后把 runningFiber->context 放到 cpu，保存 cpu 到调度协程（或主协程）
     void wxm::Fiber::resume() {
         assert(state == READY);
+        state = RUNNING; // 否则协程执行中途主动 yield() 时断言失败
 
         // FiberControl::set_running_fiber(shared_from_this()); // 提前设置当前协程为运行协程
         auto thisFiber = shared_from_this();
@@ -134,9 +135,9 @@ namespace wxm {
         if (state == RUNNING) state = READY;
 
         if (runInScheduler) {
-            auto schedulerFiber = FiberControl::get_scheduler_fiber();
-            FiberControl::set_running_fiber(schedulerFiber); // 提前设置调度协程为运行协程
-            auto runningFiber = FiberControl::get_running_fiber();
+            // 同 main_func 的大坑：协程执行完毕后不会再从 swapcontext 返回，栈上的智能指针永远不会析构，所以这里只保留裸指针
+            FiberControl::set_running_fiber(FiberControl::get_scheduler_fiber()); // 提前设置调度协程为运行协程
+            Fiber* runningFiber = FiberControl::get_running_fiber().get();
 
             int retSwapContext = swapcontext(&context, &(runningFiber->context)); // 让出执行权
             if (retSwapContext != 0) {
@@ -145,9 +146,9 @@ namespace wxm {
             }
         }
         else {
-            auto mainFiber = FiberControl::get_main_fiber();
-            FiberControl::set_running_fiber(mainFiber); // 提前设置调度协程为运行协程
-            auto runningFiber = FiberControl::get_running_fiber();
+            // 同 main_func 的大坑：协程执行完毕后不会再从 swapcontext 返回，栈上的智能指针永远不会析构，所以这里只保留裸指针
+            FiberControl::set_running_fiber(FiberControl::get_main_fiber()); // 提前设置调度协程为运行协程
+            Fiber* runningFiber = FiberControl::get_running_fiber().get();
 
             int retSwapContext = swapcontext(&context, &(runningFiber->context)); // 让出执行权
             if (retSwapContext != 0) {
@@ -168,6 +169,11 @@ namespace wxm {
     }
 
 
+    bool wxm::Fiber::is_terminated() const {
+        return state == TERM;
+    }
+
+
     void wxm::Fiber::main_func() {
         /* 大坑！如果 curr 是智能指针，yeild 后如果没有被 resume 则永远没有销毁！内存泄漏！正常情况下智能指针离开作用域计数器自动减少，关键是这里 yield 不会离开作用域！
         auto curr = FiberControl::get_running_fiber(); */
@@ -58,6 +58,7 @@ namespace wxm {
 
         uint64_t get_id() const;
         State get_state() const;
+        bool is_terminated() const; // State 是私有类型，外部调度器（如 ShardedRuntime）用它判断协程是否执行完毕、可以回收复用
 
         static void main_func();
     };
@@ -0,0 +1,260 @@
+/**
+ * @file ShardedRuntime.cpp
+ * @brief 每核一个分片的协程运行时（thread-per-core, shared-nothing）
+ * @details 分片线程的调度循环：收取消息并在（复用的）协程中执行 -> 轮流 resume 挂起的协程 -> 空闲时休眠
+ * @author wenxingming
+ * @date 2025-09-10
+ * @note My project address: https://github.com/WenXingming/Coroutine
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include <iostream>
+#include "Fiber.h"
+#include "FiberControl.h"
+#include "ShardedRuntime.h"
+namespace wxm {
+
+    thread_local ShardedRuntime* ShardedRuntime::currentRuntime(nullptr);
+    thread_local int ShardedRuntime::currentShard(-1);
+
+
+    ShardedRuntime::ShardedRuntime(size_t _shardNum) : outstanding(0), stop(false) {
+        size_t shardNum = _shardNum != 0 ? _shardNum : 1; // hardware_concurrency() 可能返回 0
+
+        for (size_t i = 0; i < shardNum; ++i) {
+            shards.push_back(std::unique_ptr<Shard>(new Shard(shardNum)));
+        }
+
+        // 所有分片都构造完毕后再启动线程，避免线程访问到尚未创建的分片
+        for (size_t i = 0; i < shardNum; ++i) {
+            shards[i]->thread = std::thread(&ShardedRuntime::run_shard, this, i);
+        }
+    }
+
+
+    ShardedRuntime::~ShardedRuntime() {
+        stop.store(true);
+        wake_all();
+        for (auto& shard : shards) {
+            shard->thread.join();
+        }
+    }
+
+
+    size_t ShardedRuntime::shard_count() const {
+        return shards.size();
+    }
+
+
+    int ShardedRuntime::current_shard() {
+        return currentShard;
+    }
+
+
+    /// @brief splitmix64 的终结函数。libstdc++ 中整数的 std::hash 是恒等映射，直接取模会让连续 key 的分布跟着 key 的规律走
+    uint64_t ShardedRuntime::mix(uint64_t _hash) {
+        _hash ^= _hash >> 30;
+        _hash *= 0xbf58476d1ce4e5b9ULL;
+        _hash ^= _hash >> 27;
+        _hash *= 0x94d049bb133111ebULL;
+        _hash ^= _hash >> 31;
+        return _hash;
+    }
+
+
+    /// @brief 把消息投递到目标分片。分片内部：直接入队（只有分片空闲后第一次提交时更新一次 outstanding）；分片之间：SPSC 环形队列；外部线程：加锁队列
+    void ShardedRuntime::post(size_t _shard, Message _msg) {
+        Shard& target = *shards[_shard];
+
+        if (currentRuntime == this && currentShard == static_cast<int>(_shard)) {
+            ++target.localPending;
+            if (!target.localCounted) {
+                target.localCounted = true;
+                outstanding.fetch_add(1);
+            }
+            target.localInbox.push_back(std::move(_msg));
+            return;
+        }
+
+        outstanding.fetch_add(1); // 必须在消息可见之前计数，否则目标分片可能先完成任务把计数减成负数
+        if (currentRuntime == this) {
+            Ring* ring = target.inbound[currentShard].load(std::memory_order_relaxed); // 只有本线程会写这个槽位
+            if (!ring) {
+                ring = new Ring();
+                target.inbound[currentShard].store(ring, std::memory_order_release); // release：消费者看到指针时队列已构造完毕
+            }
+            while (!ring->try_push(std::move(_msg))) {
+                // 队列满：在协程里就让出执行权，让本分片继续处理自己的收件箱（否则两个分片互相写满会死锁）
+                std::shared_ptr<Fiber> running = FiberControl::get_running_fiber();
+                if (running != FiberControl::get_main_fiber()) running->yield();
+                else std::this_thread::yield();
+                wake(target);
+            }
+        }
+        else {
+            std::lock_guard<std::mutex> lock(target.mtx);
+            target.externalInbox.push_back(std::move(_msg));
+        }
+        wake(target);
+    }
+
+
+    /// @brief 生产者写完队列后调用。与 run_shard 休眠前的 fence 配对（Dekker）：要么这里看到 sleeping，要么消费者看到新消息
+    void ShardedRuntime::wake(Shard& _shard) {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // 防止上面对 tail 的 store 与下面对 sleeping 的 load 重排
+        if (_shard.sleeping.load()) {
+            std::lock_guard<std::mutex> lock(_shard.mtx);
+            _shard.cv.notify_one();
+        }
+    }
+
+
+    void ShardedRuntime::wake_all() {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mtx);
+            shard->cv.notify_one();
+        }
+    }
+
+
+    /// @brief outstanding 减 1。stop 之后最后一个任务完成时，叫醒所有正在休眠的分片让它们退出
+    void ShardedRuntime::finish_outstanding() {
+        if (outstanding.fetch_sub(1) == 1 && stop.load()) wake_all();
+    }
+
+
+    /// @brief 把当前线程绑定到进程允许使用的第 (_index % 可用核数) 个 CPU 上。只在允许的 CPU 里选，容器里 cpuset 受限时也能绑定成功
+    void ShardedRuntime::pin_to_cpu(size_t _index) {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+            std::cerr << "pin_to_cpu() sched_getaffinity failed, shard " << _index << " not pinned." << std::endl;
+            return;
+        }
+
+        size_t target = _index % static_cast<size_t>(CPU_COUNT(&allowed));
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &allowed)) continue;
+            if (target-- != 0) continue;
+
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            int ret = pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+            if (ret != 0) { // 绑核失败不影响正确性，只损失缓存局部性，所以不 assert
+                std::cerr << "pin_to_cpu() pthread_setaffinity_np failed: " << std::strerror(ret) << std::endl;
+            }
+            return;
+        }
+    }
+
+
+    /// @brief 分片线程的调度循环。线程的主协程充当调度协程，每条消息在一个子协程中执行，子协程 yield 后回到这里重新排队
+    void ShardedRuntime::run_shard(size_t _index) {
+        pin_to_cpu(_index); // 先绑核，之后分配的协程栈、map 等都落在这个核附近
+        currentRuntime = this;
+        currentShard = static_cast<int>(_index);
+        Shard& self = *shards[_index];
+
+        std::deque<Task> runQueue;                          // 中途 yield 的协程，FCFS
+        std::vector<std::shared_ptr<Fiber>> idleFibers;     // 执行完毕的协程，reset() 后复用，避免每条消息都分配一次栈
+
+        auto finish = [&](Task& _task) {
+            if (idleFibers.size() < MAX_IDLE_FIBERS) idleFibers.push_back(_task.fiber);
+            if (_task.remote) finish_outstanding();
+            else --self.localPending; // 内部任务的计数留到分片空闲时统一归还，避免每条消息都碰共享原子变量
+        };
+
+        // 收到消息立即在协程中执行：执行完毕的协程马上回收，只有中途 yield 的协程才占用栈，积压的消息不会变成积压的协程
+        auto execute = [&](Message& _msg, bool _remote) {
+            std::shared_ptr<Fiber> fiber;
+            if (!idleFibers.empty()) {
+                fiber = idleFibers.back();
+                idleFibers.pop_back();
+                fiber->reset(std::move(_msg));
+            }
+            else {
+                fiber = FiberControl::create_fiber(std::move(_msg), 0, false);
+            }
+            Task task{ fiber, _remote };
+            fiber->resume();
+            if (fiber->is_terminated()) finish(task);
+            else runQueue.push_back(std::move(task));
+        };
+
+        Message msg;
+        std::deque<Message> batch;
+        while (true) {
+            bool received = false;
+
+            // 先把收件箱换出来再执行，执行过程中新提交的消息留到下一轮，避免一直提交自己的任务饿死其他收件箱
+            batch.swap(self.localInbox);
+            for (auto& m : batch) {
+                execute(m, false);
+                received = true;
+            }
+            batch.clear();
+            for (auto& slot : self.inbound) {
+                Ring* ring = slot.load(std::memory_order_acquire); // 发往自己的消息走 localInbox，自己的槽位始终为空
+                if (!ring) continue;
+                for (size_t n = 0; n < RING_CAPACITY && ring->try_pop(msg); ++n) { // 每轮最多取一圈，避免单个生产者饿死其他分片
+                    execute(msg, true);
+                    received = true;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(self.mtx);
+                batch.swap(self.externalInbox);
+            }
+            for (auto& m : batch) {
+                execute(m, true);
+                received = true;
+            }
+            batch.clear();
+
+            // 只运行本轮开始时已挂起的协程，重新 yield 的留到下一轮
+            for (size_t n = runQueue.size(); n > 0; --n) {
+                Task task = std::move(runQueue.front());
+                runQueue.pop_front();
+                task.fiber->resume();
+                if (task.fiber->is_terminated()) finish(task);
+                else runQueue.push_back(std::move(task));
+            }
+
+            if (received || !self.localInbox.empty()) continue;
+            if (!runQueue.empty()) {
+                // 本轮没有收到消息，只有反复 yield 的协程（例如在等对方取走满队列里的消息）：让出 CPU，
+                // 否则分片数多于核数时会空转一整个时间片，消费者线程得不到运行
+                std::this_thread::yield();
+                continue;
+            }
+            if (self.localCounted && self.localPending == 0) { // 分片即将空闲：归还内部任务占用的计数
+                self.localCounted = false;
+                finish_outstanding();
+            }
+            if (stop.load() && outstanding.load() == 0) break;
+
+            // 空闲：休眠等待。先发布 sleeping 再检查收件箱，与 wake() 中的 fence 配对，保证不会错过唤醒
+            std::unique_lock<std::mutex> lock(self.mtx);
+            self.sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst); // 防止 sleeping 的 store 与下面对 tail 的 load 重排
+            auto has_work = [&]() {
+                if (!self.externalInbox.empty()) return true;
+                for (auto& slot : self.inbound) {
+                    Ring* ring = slot.load(std::memory_order_acquire);
+                    if (ring && !ring->empty()) return true;
+                }
+                return stop.load() && outstanding.load() == 0; // 需要退出也算
+            };
+            while (!has_work()) self.cv.wait(lock);
+            self.sleeping.store(false);
+        }
+
+        currentRuntime = nullptr;
+        currentShard = -1;
+    }
+
+
+}
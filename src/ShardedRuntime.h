@@ -0,0 +1,120 @@
+/**
+ * @file ShardedRuntime.h
+ * @brief 每核一个分片的协程运行时（thread-per-core, shared-nothing）
+ * @details 每个分片独占一个线程并绑定到一个 CPU（分片数多于可用核数时按编号取模轮流绑定），线程内由 FiberControl 驱动协程调度。协程从不在线程间迁移，所以 thread_local 状态始终有效。
+ * 分片内部提交任务走本线程独占的队列，不加锁、不访问任何共享原子变量（只在分片从空闲变忙、从忙变空闲时各更新一次全局计数）；
+ * 协程切换时 shared_ptr 的引用计数仍是原子操作，但只在本核缓存上，没有竞争。分片之间通过定长 SPSC 环形队列（每对分片一个）传递消息，submit_to() 返回 std::future
+ * @author wenxingming
+ * @date 2025-09-10
+ * @note My project address: https://github.com/WenXingming/Coroutine
+ */
+
+#pragma once
+#include <cstdint>
+#include <cassert>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "SpscRing.h"
+namespace wxm {
+
+    class Fiber;
+
+    class ShardedRuntime {
+    private:
+        typedef std::function<void()> Message;
+
+        static const size_t RING_CAPACITY = 128;    // 每对分片之间环形队列的容量。队列满时生产者协程会 yield，不需要很大
+        static const size_t MAX_IDLE_FIBERS = 64;   // 每个分片缓存的空闲协程上限（每个协程 128 KB 栈）
+
+        typedef SpscRing<Message, RING_CAPACITY> Ring;
+
+        struct Task {
+            std::shared_ptr<Fiber> fiber;
+            bool remote;                            // 是否来自其他线程（决定完成时如何维护 outstanding）
+        };
+
+        struct Shard {
+            std::thread thread;
+            // inbound[from]：分片 from 发往本分片的消息，from 是唯一生产者。N 个分片最多有 N*(N-1) 个队列，所以第一次发送时才由生产者创建
+            std::vector<std::atomic<Ring*>> inbound;
+
+            std::deque<Message> localInbox;         // 本分片协程提交给自己的消息，只有本线程访问，不加锁
+            size_t localPending = 0;                // 本分片内部提交、尚未完成的任务数，只有本线程访问
+            bool localCounted = false;              // 本分片是否已为内部任务在 outstanding 里计了 1，只有本线程访问
+
+            std::mutex mtx;                         // 保护 externalInbox，并配合 cv 实现空闲休眠
+            std::condition_variable cv;
+            std::deque<Message> externalInbox;      // 非分片线程（例如主线程）提交的消息，生产者不唯一，只能加锁
+            std::atomic<bool> sleeping;
+
+            explicit Shard(size_t _shardNum) : inbound(_shardNum), sleeping(false) {
+                for (auto& ring : inbound) ring.store(nullptr);
+            }
+            ~Shard() {
+                for (auto& ring : inbound) delete ring.load();
+            }
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        // 所有未完成任务的计数：跨线程任务各计 1；分片内部任务按分片计（有内部任务时计 1，直到分片空闲、localPending 为 0 时才减掉）。
+        // 新任务只能由未完成的任务或外部线程提交，所以 stop 之后它降到 0 就不会再增加，分片据此安全退出
+        std::atomic<int64_t> outstanding;
+        std::atomic<bool> stop;
+
+        static thread_local ShardedRuntime* currentRuntime; // 当前线程所属的运行时（非分片线程为 nullptr）
+        static thread_local int currentShard;               // 当前线程的分片编号（非分片线程为 -1）
+
+        void post(size_t _shard, Message _msg);
+        void wake(Shard& _shard);
+        void wake_all();
+        void finish_outstanding();
+        void run_shard(size_t _index);
+        static void pin_to_cpu(size_t _index);
+
+        static uint64_t mix(uint64_t _hash);
+
+    public:
+        explicit ShardedRuntime(size_t _shardNum = std::thread::hardware_concurrency());
+        ShardedRuntime(const ShardedRuntime& other) = delete;
+        ShardedRuntime& operator=(const ShardedRuntime& other) = delete;
+        ~ShardedRuntime(); // 等待所有已提交的任务执行完毕后再结束分片线程
+
+        size_t shard_count() const;
+        static int current_shard();
+
+        // 按 key 的哈希选择分片，同一个 key 总是落在同一个分片上（亲和性）
+        template<typename Key>
+        size_t shard_of(const Key& _key) const {
+            return mix(std::hash<Key>()(_key)) % shards.size();
+        }
+
+        /// @brief 在分片 _shard 的协程中执行 _fn，返回其结果的 future
+        /// @attention 不要在分片线程里对 future 调用 get()/wait()，那会阻塞整个分片；在协程中可以先 yield 再检查 future 是否就绪
+        template<typename F>
+        std::future<typename std::result_of<F()>::type> submit_to(size_t _shard, F _fn) {
+            typedef typename std::result_of<F()>::type R;
+            assert(_shard < shards.size());
+
+            // packaged_task 不可拷贝，而 std::function 要求可拷贝，所以用 shared_ptr 包一层
+            std::shared_ptr<std::packaged_task<R()>> task = std::make_shared<std::packaged_task<R()>>(std::move(_fn));
+            std::future<R> result = task->get_future();
+            post(_shard, [task]() { (*task)(); });
+            return result;
+        }
+
+        template<typename Key, typename F>
+        std::future<typename std::result_of<F()>::type> submit(const Key& _key, F _fn) {
+            return submit_to(shard_of(_key), std::move(_fn));
+        }
+    };
+
+
+}
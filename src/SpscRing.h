@@ -0,0 +1,66 @@
+/**
+ * @file SpscRing.h
+ * @brief 单生产者单消费者无锁环形队列
+ * @details 定长环形缓冲区，容量必须是 2 的幂。只允许一个线程 push、一个线程 pop，因此只需要 acquire/release 原子操作，无需加锁
+ * @author wenxingming
+ * @date 2025-09-10
+ * @note My project address: https://github.com/WenXingming/Coroutine
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+namespace wxm {
+
+
+    template<typename T, size_t Capacity>
+    class SpscRing {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of 2");
+
+    private:
+        static const size_t CACHE_LINE = 64;
+        static const size_t MASK = Capacity - 1;
+
+        // head 只由消费者写，tail 只由生产者写。中间填充到不同 cache line，避免伪共享（C++11 下 new 不保证 alignas 超对齐，所以用填充）
+        std::atomic<size_t> head;       // 下一个要读取的位置（消费者）
+        char padHead[CACHE_LINE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail;       // 下一个要写入的位置（生产者）
+        char padTail[CACHE_LINE - sizeof(std::atomic<size_t>)];
+        T buffer[Capacity];
+
+    public:
+        SpscRing() : head(0), tail(0) {}
+        SpscRing(const SpscRing& other) = delete;
+        SpscRing& operator=(const SpscRing& other) = delete;
+
+        // 生产者调用。队列满返回 false，_val 保持不变
+        bool try_push(T&& _val) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+            buffer[t & MASK] = std::move(_val);
+            tail.store(t + 1, std::memory_order_release); // release：保证 buffer 的写入先于 tail 对消费者可见
+            return true;
+        }
+
+        // 消费者调用。队列空返回 false
+        bool try_pop(T& _out) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return false;
+            _out = std::move(buffer[h & MASK]);
+            buffer[h & MASK] = T(); // 及时释放槽位持有的资源（例如 std::function 捕获的 shared_ptr）
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+        static size_t capacity() {
+            return Capacity;
+        }
+    };
+
+
+}
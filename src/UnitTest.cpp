@@ -12,9 +12,17 @@
 #include <chrono>
 #include <atomic>
 #include <cassert>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
 #include "Semaphore.h" 
 #include "Fiber.h"
 #include "FiberControl.h"
+#include "SpscRing.h"
+#include "ShardedRuntime.h"
 
 
 /// @brief Test Semaphore: 基本阻塞与唤醒 (test_basic_semaphore)
@@ -144,6 +152,326 @@ void test_fiber_total() {
 }
 
 
+/// @brief Test SpscRing: 一个生产者线程、一个消费者线程，容量很小，反复触发队列满/空
+void test_spsc_ring() {
+    std::cout << "--- Testing SpscRing ---" << std::endl;
+
+    const int total = 100000;
+    wxm::SpscRing<int, 4> ring;
+    std::thread producer([&]() {
+        for (int i = 0; i < total; ++i) {
+            int val = i;
+            while (!ring.try_push(std::move(val))) std::this_thread::yield();
+        }
+        });
+
+    for (int expect = 0; expect < total; ++expect) { // 单生产者单消费者，必须严格 FIFO
+        int val = -1;
+        while (!ring.try_pop(val)) std::this_thread::yield();
+        assert(val == expect);
+    }
+    producer.join();
+    assert(ring.empty());
+
+    std::cout << "--- SpscRing Test Passed ---" << std::endl;
+}
+
+
+/// @brief Test ShardedRuntime: key 亲和性、协程 yield 后不迁移线程、分片之间 submit_to
+void test_sharded_runtime() {
+    std::cout << "--- Testing ShardedRuntime ---" << std::endl;
+
+    wxm::ShardedRuntime rt(4);
+    assert(rt.shard_count() == 4);
+    assert(wxm::ShardedRuntime::current_shard() == -1);
+
+    // 同一个 key 总是在同一个分片上执行
+    for (uint64_t key = 0; key < 64; ++key) {
+        size_t shard = rt.shard_of(key);
+        int ran = rt.submit(key, []() { return wxm::ShardedRuntime::current_shard(); }).get();
+        assert(ran == static_cast<int>(shard));
+        (void)shard; (void)ran; // NDEBUG 下 assert 为空
+    }
+
+    // 协程中途 yield，恢复后仍在同一个线程上（thread_local 保持有效）
+    std::vector<std::future<bool>> stay;
+    for (size_t shard = 0; shard < rt.shard_count(); ++shard) {
+        stay.push_back(rt.submit_to(shard, []() {
+            std::thread::id before = std::this_thread::get_id();
+            for (int i = 0; i < 10; ++i) wxm::FiberControl::get_running_fiber()->yield();
+            return std::this_thread::get_id() == before;
+            }));
+    }
+    for (auto& f : stay) {
+        bool same = f.get(); // get() 不能放进 assert，否则 NDEBUG 下不会等待
+        assert(same);
+        (void)same;
+    }
+
+    // 分片之间传递消息：每个分片向其他所有分片提交大量任务（超过环形队列容量，触发队列满时 yield）
+    const int perPair = 3000;
+    std::vector<std::future<std::vector<std::future<int>>>> fanout;
+    for (size_t from = 0; from < rt.shard_count(); ++from) {
+        fanout.push_back(rt.submit_to(from, [&rt]() {
+            std::vector<std::future<int>> results;
+            for (size_t to = 0; to < rt.shard_count(); ++to) {
+                for (int i = 0; i < perPair; ++i) {
+                    results.push_back(rt.submit_to(to, [to]() {
+                        assert(wxm::ShardedRuntime::current_shard() == static_cast<int>(to));
+                        return 1;
+                        }));
+                }
+            }
+            return results;
+            }));
+    }
+    int sum = 0;
+    for (auto& f : fanout) {
+        std::vector<std::future<int>> results = f.get();
+        for (auto& r : results) sum += r.get();
+    }
+    assert(sum == perPair * static_cast<int>(rt.shard_count() * rt.shard_count()));
+
+    // 析构时必须把已提交但没人等待的任务全部执行完，包括这些任务在析构期间继续提交的跨分片、分片内部任务。
+    // 根任务都在分片 0 上，分几批、中间 yield 着往其他分片发，让其他分片在两批之间空闲，检验它们不会在 stop 之后提前退出
+    std::atomic<int> done(0);
+    const int roots = 40;           // 每个目标分片收到 roots * bursts / 2 = 100 条消息，小于环形队列容量，出错时是断言失败而不是卡死
+    const int bursts = 5;
+    {
+        wxm::ShardedRuntime drain(3);
+        for (int i = 0; i < roots; ++i) {
+            drain.submit_to(0, [&drain, &done, bursts]() { // 丢弃 future，不等待
+                for (int b = 0; b < bursts; ++b) {
+                    for (int y = 0; y < 10; ++y) wxm::FiberControl::get_running_fiber()->yield();
+                    drain.submit_to(1 + b % 2, [&drain, &done]() {
+                        drain.submit_to(wxm::ShardedRuntime::current_shard(), [&done]() {
+                            wxm::FiberControl::get_running_fiber()->yield();
+                            ++done;
+                            });
+                        ++done;
+                        });
+                }
+                ++done;
+                });
+        }
+    }
+    assert(done.load() == roots * (1 + bursts * 2));
+
+    std::cout << "--- ShardedRuntime Test Passed ---" << std::endl;
+}
+
+
+/// @brief 对照组：所有线程共享一个加锁任务队列的线程池（仓库里还没有工作窃取池，这里用共享队列代替）
+class SharedQueuePool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop = false;
+
+public:
+    explicit SharedQueuePool(size_t threadNum) {
+        for (size_t i = 0; i < threadNum; ++i) {
+            workers.emplace_back([this]() {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mtx);
+                        cv.wait(lock, [this]() { return stop || !tasks.empty(); });
+                        if (stop && tasks.empty()) return;
+                        task = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+                    task();
+                }
+                });
+        }
+    }
+
+    ~SharedQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> submit(F fn) {
+        typedef typename std::result_of<F()>::type R;
+        std::shared_ptr<std::packaged_task<R()>> task = std::make_shared<std::packaged_task<R()>>(std::move(fn));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            tasks.push_back([task]() { (*task)(); });
+        }
+        cv.notify_one();
+        return result;
+    }
+
+    // 在调用线程上执行一个排队的任务。队列为空返回 false。用于工作线程等待结果时帮忙干活，避免所有线程都阻塞而死锁
+    bool try_run_one() {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (tasks.empty()) return false;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+};
+
+
+/// @brief 一个分区的 key-value 存储。各分区单独分配并在前后填充 cache line，避免相邻分区的 map 头部伪共享
+struct KvPartition {
+    char padBefore[64];
+    std::unordered_map<uint64_t, uint64_t> map;
+    std::mutex mtx;                 // 只有共享队列池使用；分片运行时每个分区只由所属分片访问，不加锁
+    char padAfter[64];
+};
+
+
+/// @brief Benchmark: 分区 key-value 计数。两边都由 threadNum 个驱动任务在工作线程内部生成请求（相同的扇入）：
+/// 分片运行时按 key 把请求路由到所属分片（本分片走 localInbox，其他分片走 SPSC 环形队列），分区无锁；
+/// 共享队列池把请求提交回同一个加锁队列，分区加锁。
+/// 总请求数与核数无关；每个驱动最多保留 WINDOW 个未取结果的 future，边提交边消费，内存占用有上限
+void bench_sharded_vs_shared_pool() {
+    std::cout << "--- Benchmark: ShardedRuntime vs SharedQueuePool (partitioned key-value) ---" << std::endl;
+
+    const size_t threadNum = std::max(2u, std::thread::hardware_concurrency());
+    const uint64_t keyNum = 4096;
+    const uint64_t opNum = 100000;
+    const size_t WINDOW = 256;
+    const int rounds = 3;
+
+    auto make_key = [=](size_t driver, uint64_t i) {
+        return (driver * opNum + i) * 2654435761ULL % keyNum;
+    };
+    auto ops_of = [=](size_t driver) { // 把 opNum 平均分给各个驱动，余数给前几个
+        return opNum / threadNum + (driver < opNum % threadNum ? 1 : 0);
+    };
+
+    auto make_partitions = [](size_t n) {
+        std::vector<std::unique_ptr<KvPartition>> parts;
+        for (size_t i = 0; i < n; ++i) parts.push_back(std::unique_ptr<KvPartition>(new KvPartition()));
+        return parts;
+    };
+
+    auto sum_partitions = [](const std::vector<std::unique_ptr<KvPartition>>& parts) {
+        uint64_t total = 0;
+        for (auto& part : parts) for (auto& kv : part->map) total += kv.second;
+        return total;
+    };
+
+    auto run_sharded = [&]() {
+        wxm::ShardedRuntime rt(threadNum);
+        std::vector<std::unique_ptr<KvPartition>> parts = make_partitions(rt.shard_count()); // parts[i] 只由分片 i 访问
+        std::vector<std::future<uint64_t>> drivers;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t d = 0; d < rt.shard_count(); ++d) {
+            drivers.push_back(rt.submit_to(d, [&rt, &parts, &make_key, &ops_of, d, WINDOW]() {
+                std::deque<std::future<uint64_t>> window;
+                uint64_t consumed = 0;
+                // 分片线程里不能阻塞在 future 上：结果没就绪就 yield，让本分片先处理收件箱
+                auto consume_front = [&]() {
+                    while (window.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                        wxm::FiberControl::get_running_fiber()->yield();
+                    }
+                    window.front().get();
+                    window.pop_front();
+                    ++consumed;
+                };
+                for (uint64_t i = 0; i < ops_of(d); ++i) {
+                    if (window.size() == WINDOW) consume_front();
+                    uint64_t key = make_key(d, i);
+                    window.push_back(rt.submit(key, [&parts, key]() {
+                        return ++parts[wxm::ShardedRuntime::current_shard()]->map[key];
+                        }));
+                }
+                while (!window.empty()) consume_front();
+                return consumed;
+                }));
+        }
+        uint64_t consumed = 0;
+        for (auto& driver : drivers) consumed += driver.get();
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t total = sum_partitions(parts);
+        assert(consumed == opNum && total == opNum);
+        (void)consumed; (void)total;
+        return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    };
+
+    auto run_shared = [&]() {
+        SharedQueuePool pool(threadNum);
+        std::vector<std::unique_ptr<KvPartition>> parts = make_partitions(threadNum);
+        std::vector<std::future<uint64_t>> drivers;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t d = 0; d < threadNum; ++d) {
+            drivers.push_back(pool.submit([&pool, &parts, &make_key, &ops_of, d, WINDOW, threadNum]() {
+                std::deque<std::future<uint64_t>> window;
+                uint64_t consumed = 0;
+                // 所有工作线程都在跑驱动，直接阻塞会死锁：结果没就绪就帮忙执行队列里的任务
+                auto consume_front = [&]() {
+                    while (window.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                        if (!pool.try_run_one()) std::this_thread::yield();
+                    }
+                    window.front().get();
+                    window.pop_front();
+                    ++consumed;
+                };
+                for (uint64_t i = 0; i < ops_of(d); ++i) {
+                    if (window.size() == WINDOW) consume_front();
+                    uint64_t key = make_key(d, i);
+                    KvPartition* part = parts[key % threadNum].get();
+                    window.push_back(pool.submit([part, key]() {
+                        std::lock_guard<std::mutex> lock(part->mtx);
+                        return ++part->map[key];
+                        }));
+                }
+                while (!window.empty()) consume_front();
+                return consumed;
+                }));
+        }
+        uint64_t consumed = 0;
+        for (auto& driver : drivers) consumed += driver.get();
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t total = sum_partitions(parts);
+        assert(consumed == opNum && total == opNum);
+        (void)consumed; (void)total;
+        return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    };
+
+    // 先各跑一遍预热（线程创建、分配器、页表），不计时；之后每轮交替先后顺序，取中位数
+    run_sharded();
+    run_shared();
+    std::vector<long long> shardedMs, sharedMs;
+    for (int r = 0; r < rounds; ++r) {
+        if (r % 2 == 0) {
+            shardedMs.push_back(run_sharded());
+            sharedMs.push_back(run_shared());
+        }
+        else {
+            sharedMs.push_back(run_shared());
+            shardedMs.push_back(run_sharded());
+        }
+    }
+    std::sort(shardedMs.begin(), shardedMs.end());
+    std::sort(sharedMs.begin(), sharedMs.end());
+
+    std::cout << "threads: " << threadNum << ", ops: " << opNum << ", keys: " << keyNum << ", rounds: " << rounds << std::endl;
+    std::cout << "ShardedRuntime:  median " << shardedMs[rounds / 2] << " ms (min " << shardedMs.front() << ", max " << shardedMs.back() << ")" << std::endl;
+    std::cout << "SharedQueuePool: median " << sharedMs[rounds / 2] << " ms (min " << sharedMs.front() << ", max " << sharedMs.back() << ")" << std::endl;
+    std::cout << "--- Benchmark Done ---" << std::endl;
+}
+
 int main() {
     test_basic_semaphore();
     std::cout << "\n";
@@ -151,6 +479,12 @@ int main() {
     std::cout << "\n";
     test_fiber_total();
     std::cout << "\n";
+    test_spsc_ring();
+    std::cout << "\n";
+    test_sharded_runtime();
+    std::cout << "\n";
+    bench_sharded_vs_shared_pool();
+    std::cout << "\n";
 
     std::cout << "All tests completed successfully!\n" << std::endl;
     return 0;